@@ -20,11 +20,16 @@ const unordered_map<string, COMMAND> CLI::STRING_TO_COMMAND = {
     { "show_settings", COMMAND::SHOW_SETTINGS },
     { "set_alg", COMMAND::SET_ALG },
     { "set_threads", COMMAND::SET_THREADS },
+    { "set_memory", COMMAND::SET_MEMORY },
     { "run", COMMAND::RUN },
+    { "build_index", COMMAND::BUILD_INDEX },
+    { "find", COMMAND::FIND },
+    { "phrase", COMMAND::PHRASE },
     { "quit", COMMAND::QUIT }
 };
 
 Analyzer CLI::analyzer;
+InvertedIndex CLI::index;
 
 CLI::CLI() {
     loop_is_running = true;
@@ -56,9 +61,14 @@ vector<string> CLI::create_tokens(const string& input) {
     vector<string> tokens;
     string current_token = "";
 
-    // Add tokens separated by whitespace
+    bool in_quotes = false;
+
+    // Add tokens separated by whitespace. Text between double quotes is kept together as one token, without the quotes.
     for(char ch : input) {
-        if(isspace(ch)) {
+        if(ch == '"') {
+            in_quotes = !in_quotes;
+        }
+        else if(isspace(ch) && !in_quotes) {
             if(!current_token.empty()) {
                 tokens.push_back(current_token);
                 current_token = "";
@@ -130,6 +140,14 @@ void CLI::parse_tokens(const vector<string>& tokens) {
                     print_generic_error();
                 }
             break;
+            case(COMMAND::SET_MEMORY):
+                if (tokens.size() == 2) {
+                    command_set_memory(tokens[1]);
+                }
+                else {
+                    print_generic_error();
+                }
+            break;
             case(COMMAND::RUN):
                 if (tokens.size() == 1) {
                     command_run();
@@ -138,6 +156,30 @@ void CLI::parse_tokens(const vector<string>& tokens) {
                     print_generic_error();
                 }
             break;
+            case(COMMAND::BUILD_INDEX):
+                if (tokens.size() == 1) {
+                    command_build_index();
+                }
+                else {
+                    print_generic_error();
+                }
+            break;
+            case(COMMAND::FIND):
+                if (tokens.size() == 2) {
+                    command_find(tokens[1]);
+                }
+                else {
+                    print_generic_error();
+                }
+            break;
+            case(COMMAND::PHRASE):
+                if (tokens.size() == 2) {
+                    command_phrase(tokens[1]);
+                }
+                else {
+                    print_generic_error();
+                }
+            break;
             case(COMMAND::QUIT):
                 if (tokens.size() == 1) {
                     command_quit();
@@ -169,7 +211,11 @@ void CLI::command_help() {
     "   explain [COMMAND]                   Explains how to use the specified command.\n" <<
     "   set_alg [ALGORITHM]                 Sets the algorithm to be used when the 'run' command is called.\n" <<
     "   set_threads [NUMBER_OF_THREADS]     Sets the number of threads for multithreaded algorithms to use.\n" <<
+    "   set_memory [MEGABYTES]              Sets the memory budget for the external_memory algorithm.\n" <<
     "   run                                 Runs the algorithm and displays statistics.\n" <<
+    "   build_index                         Builds a searchable index of the books and saves it to disk.\n" <<
+    "   find [WORD]                         Lists where a word occurs, using the index.\n" <<
+    "   phrase \"[WORDS]\"                    Lists where a phrase occurs, using the index.\n" <<
     "   quit                                Quits the application.\n\n";
 }
 
@@ -195,7 +241,11 @@ void CLI::command_explain(const string& input) {
                 "   explain\n" <<
                 "   set_alg\n" <<
                 "   set_threads\n" <<
+                "   set_memory\n" <<
                 "   run\n" <<
+                "   build_index\n" <<
+                "   find\n" <<
+                "   phrase\n" <<
                 "   quit\n" <<
 
                 "\nDESCRIPTION:\n" <<
@@ -219,6 +269,7 @@ void CLI::command_explain(const string& input) {
                 "   multi_thread_1\n" <<
                 "   multi_thread_2\n" <<
                 "   multi_thread_3\n" <<
+                "   external_memory\n" <<
 
                 "\nDESCRIPTION:\n" <<
                 "   The -> set_alg command sets the algorithm to be used when -> run is called.\n" <<
@@ -231,7 +282,11 @@ void CLI::command_explain(const string& input) {
                 "       multi_thread_2\n" <<
                 "           This algorithm runs different files on different threads.\n" <<
                 "       multi_thread_3\n" <<
-                "           This algorithm runs different chunks of text, potentially from the same file, on different threads.\n\n";
+                "           This algorithm runs different chunks of text, potentially from the same file, on different threads.\n" <<
+                "       external_memory\n" <<
+                "           This algorithm runs on a single thread and keeps its word frequency table under the budget set by -> set_memory.\n" <<
+                "           When the table fills up, it is written to disk as a sorted run, and the runs are merged once every file is read.\n" <<
+                "           Results are exact, and the peak memory and bytes spilled to disk are reported.\n\n";
             break;
             case(COMMAND::SET_THREADS):
                 cout <<
@@ -245,6 +300,18 @@ void CLI::command_explain(const string& input) {
                 "   The -> set_threads command sets how manys threads the multithreaded algorithms will use.\n" <<
                 "   Multithreaded algorithms must use at least 2 threads.\n\n";
             break;
+            case(COMMAND::SET_MEMORY):
+                cout <<
+                "\nSYNTAX:\n" <<
+                "   -> set_memory [MEGABYTES]\n"
+
+                "\nVALID NUMBERS OF MEGABYTES:\n" <<
+                "   1 to 65536\n" <<
+
+                "\nDESCRIPTION:\n" <<
+                "   The -> set_memory command sets how large the external_memory algorithm's word frequency table may grow\n" <<
+                "   before it is written to disk.\n\n";
+            break;
             case(COMMAND::RUN):
                 cout <<
                 "\nSYNTAX:\n" <<
@@ -253,6 +320,34 @@ void CLI::command_explain(const string& input) {
                 "\nDESCRIPTION:\n" <<
                 "   Runs the application with the current algorithm and thread count.\n\n";
             break;
+            case(COMMAND::BUILD_INDEX):
+                cout <<
+                "\nSYNTAX:\n" <<
+                "   -> build_index\n" <<
+
+                "\nDESCRIPTION:\n" <<
+                "   Builds an index of where every word occurs in the books, using the number of threads set by -> set_threads.\n" <<
+                "   The index is saved as Books.index next to the Books directory, and is used by -> find and -> phrase.\n" <<
+                "   Index size and build throughput are displayed once the index is built.\n\n";
+            break;
+            case(COMMAND::FIND):
+                cout <<
+                "\nSYNTAX:\n" <<
+                "   -> find [WORD]\n" <<
+
+                "\nDESCRIPTION:\n" <<
+                "   Lists how many times a word occurs in each book, along with the word offsets of its first few occurrences.\n" <<
+                "   Searches are not case sensitive. Requires an index built by -> build_index.\n\n";
+            break;
+            case(COMMAND::PHRASE):
+                cout <<
+                "\nSYNTAX:\n" <<
+                "   -> phrase \"[WORDS]\"\n" <<
+
+                "\nDESCRIPTION:\n" <<
+                "   Lists how many times the words occur one after another in each book, along with the word offsets of the first few matches.\n" <<
+                "   Searches are not case sensitive and ignore punctuation. Requires an index built by -> build_index.\n\n";
+            break;
             case(COMMAND::QUIT):
                 cout <<
                 "\nSYNTAX:\n" <<
@@ -275,7 +370,8 @@ void CLI::command_explain(const string& input) {
 void CLI::command_show_settings() {
     cout << 
     "\nCurrent algorithm: " << analyzer.get_alg() << "\n"
-    "Number of threads that will be used: " << analyzer.get_threads() << "\n\n";
+    "Number of threads that will be used: " << analyzer.get_threads() << "\n"
+    "Memory budget for external_memory: " << analyzer.get_memory_budget() << " MB\n\n";
 }
 
 // Set algorithm to use when application is ran
@@ -309,10 +405,36 @@ void CLI::command_set_threads(const string& input) {
     }
 }
 
+// Set memory budget for the external memory algorithm
+void CLI::command_set_memory(const string& input) {
+    int input_int = 0;
+    try {
+        input_int = stoi(input);
+    }
+    catch (...){
+        print_set_memory_error();
+        return;
+    }
+
+    if (analyzer.set_memory_budget(input_int)) {
+        cout << "\nMemory budget set sucessfully.\n\n";
+    }
+    else {
+        print_set_memory_error();
+    }
+}
+
 // Run the selected algorithm and display stats
 void CLI::command_run() {
     const AnalyzerData* data = analyzer.run_analysis();
 
+    if (!data->error.empty()) {
+        cout << "\nERROR: " << data->error << "\nNo statistics are shown because they would be incomplete.\n\n";
+        delete data;
+        data = nullptr;
+        return;
+    }
+
     cout << 
     "\nNumber of unique words: " << data->num_unique_words <<
     "\nMost common word: " << data->most_common_word <<
@@ -320,12 +442,83 @@ void CLI::command_run() {
     "\nLongest word: " << data->longest_word <<
     "\nAverage word length: " << data->average_word_length <<
     "\nTotal words: " << data->total_words;
+    if (analyzer.get_alg() == "external_memory") {
+        cout <<
+        "\n\nPeak frequency table size: " << data->peak_table_bytes / 1024 << " KB" <<
+        "\nPeak process memory during run: ";
+        if (data->peak_rss_bytes > 0) {
+            cout << data->peak_rss_bytes / 1024 << " KB";
+        }
+        else {
+            cout << "not available (an earlier run already set a higher peak)";
+        }
+        cout <<
+        "\nBytes spilled to disk: " << data->spill_bytes << " (" << data->spill_runs << " runs)";
+    }
     cout << "\n\nProcessing time: " << data->processing_time << " seconds \n\n";
 
     delete data;
     data = nullptr;
 }
 
+// Build the index and display its statistics
+void CLI::command_build_index() {
+    cout << "\nBuilding index, please wait...\n";
+
+    const IndexData* data = index.build(analyzer.get_threads());
+
+    if (!data->error.empty()) {
+        cout << "\nERROR: " << data->error << "\n\n";
+        delete data;
+        data = nullptr;
+        return;
+    }
+
+    cout <<
+    "\nBooks indexed: " << data->num_books <<
+    "\nUnique words: " << data->num_unique_words <<
+    "\nPostings: " << data->num_postings <<
+    "\nUncompressed postings size: " << data->raw_postings_bytes / 1024 << " KB" <<
+    "\nCompressed postings size: " << data->compressed_bytes / 1024 << " KB" <<
+    "\nIndex file size: " << data->index_file_bytes / 1024 << " KB";
+    if (data->index_file_bytes == 0) {
+        cout << " (the index could not be saved to disk)";
+    }
+    cout << "\n\nBuild time: " << data->build_time << " seconds" <<
+    "\nBuild throughput: " << (data->build_time > 0 ? data->bytes_read / data->build_time / (1024 * 1024) : 0) << " MB/s\n\n";
+
+    delete data;
+    data = nullptr;
+}
+
+// Search the index for a word
+void CLI::command_find(const string& input) {
+    const SearchData* data = index.find(input);
+    if (data == nullptr) {
+        print_missing_index_error();
+        return;
+    }
+
+    print_search_results(data);
+
+    delete data;
+    data = nullptr;
+}
+
+// Search the index for a phrase
+void CLI::command_phrase(const string& input) {
+    const SearchData* data = index.phrase(input);
+    if (data == nullptr) {
+        print_missing_index_error();
+        return;
+    }
+
+    print_search_results(data);
+
+    delete data;
+    data = nullptr;
+}
+
 // Exit application
 void CLI::command_quit() {
     loop_is_running = false;
@@ -344,4 +537,36 @@ void CLI::print_set_threads_error() {
     cout << 
     "\nInvalid value supplied.\n" <<
     "Please supply a value in the range [2, " << (thread::hardware_concurrency() == 0u ? 2 : thread::hardware_concurrency()) << "].\n\n";
+}
+
+void CLI::print_set_memory_error() {
+    cout << 
+    "\nInvalid value supplied.\n" <<
+    "Please supply a number of megabytes in the range [1, 65536].\n\n";
+}
+
+void CLI::print_search_results(const SearchData* data) {
+    if (!data->error.empty()) {
+        cout << "\nERROR: " << data->error << "\n\n";
+        return;
+    }
+
+    cout << "\nTotal matches: " << data->total_matches << "\n";
+    for (const BookMatches& book : data->books) {
+        cout << "   " << book.book << ": " << book.count << " (first word offsets:";
+        for (uint32_t word_offset : book.first_offsets) {
+            cout << " " << word_offset;
+        }
+        cout << ")\n";
+    }
+    if (data->load_time > 0) {
+        cout << "\nIndex load time: " << data->load_time * 1000 << " milliseconds (first search this session)";
+    }
+    cout << "\nQuery time: " << data->query_time * 1000 << " milliseconds \n\n";
+}
+
+void CLI::print_missing_index_error() {
+    cout <<
+    "\nNo up to date index was found.\n" <<
+    "Type -> build_index   to build one.\n\n";
 }
\ No newline at end of file
@@ -7,6 +7,7 @@
 #include <vector>
 #include <unordered_map>
 #include "analyzer.h"
+#include "index.h"
 
 // An enumerator to help handle commands in token_parser().
 enum class COMMAND {
@@ -15,7 +16,11 @@ enum class COMMAND {
     SHOW_SETTINGS,
     SET_ALG,
     SET_THREADS,
+    SET_MEMORY,
     RUN,
+    BUILD_INDEX,
+    FIND,
+    PHRASE,
     QUIT
 };
 
@@ -38,10 +43,17 @@ private:
     void command_show_settings();
     void command_set_alg(const std::string& input);
     void command_set_threads(const std::string& input);
+    void command_set_memory(const std::string& input);
     void command_run();
+    void command_build_index();
+    void command_find(const std::string& input);
+    void command_phrase(const std::string& input);
     void command_quit();
     void print_generic_error();
     void print_set_threads_error();
+    void print_set_memory_error();
+    void print_search_results(const SearchData* data);
+    void print_missing_index_error();
 
     // keeps core loop running until quit is called
     bool loop_is_running;
@@ -51,4 +63,5 @@ private:
     static const std::unordered_map<std::string, COMMAND> STRING_TO_COMMAND;
 
     static Analyzer analyzer;
+    static InvertedIndex index;
 };
\ No newline at end of file
@@ -21,6 +21,9 @@
 #include <functional>
 #include <utility>
 #include <mutex>
+#include <queue>
+#include <cstdint>
+#include <sys/resource.h>
 
 using namespace std;
 
@@ -35,20 +38,33 @@ const std::unordered_map<std::string, ALG> Analyzer::STRING_TO_ALG = {
     { "single_thread", ALG::SINGLE_THREAD },
     { "multi_thread_1", ALG::MULTI_THREAD_1 },
     { "multi_thread_2", ALG::MULTI_THREAD_2 },
-    { "multi_thread_3", ALG::MULTI_THREAD_3 }
+    { "multi_thread_3", ALG::MULTI_THREAD_3 },
+    { "external_memory", ALG::EXTERNAL_MEMORY }
 };
 
 const std::unordered_map<ALG, std::string> Analyzer::ALG_TO_STRING  = {
     { ALG::SINGLE_THREAD, "single_thread" },
     { ALG::MULTI_THREAD_1, "multi_thread_1" },
     { ALG::MULTI_THREAD_2, "multi_thread_2" },
-    { ALG::MULTI_THREAD_3, "multi_thread_3" }
+    { ALG::MULTI_THREAD_3, "multi_thread_3" },
+    { ALG::EXTERNAL_MEMORY, "external_memory" }
 };
 
+// Limits for the external_memory table budget, in megabytes
+static const int MIN_MEMORY_BUDGET_MB = 1;
+static const int MAX_MEMORY_BUDGET_MB = 65536;
+
+// Estimated memory for one open run while merging: the ifstream and its buffer, plus the reader's current word
+static const long long RUN_READER_BYTES = 16 * 1024;
+
+// Most runs merged at once, which keeps well under the usual limit of 1024 open files
+static const size_t MAX_MERGE_FAN_IN = 256;
+
 
 
 Analyzer::Analyzer() {
     num_threads = 2;
+    memory_budget_mb = 64;
     algorithm = ALG::SINGLE_THREAD;
 }
 
@@ -187,6 +203,404 @@ void Analyzer::alg_mt1_thread(TASK task, AnalyzerData* out_data, std::unordered_
     //cout << "\nThread finished.\n";
 }
 
+// Estimated heap cost of one word in an unordered_map<string, int>:
+// the node (next pointer, cached hash, key and value) plus the key's buffer if it is too long for the small string optimization.
+// One more pointer is added for the sorted_entries() vector, which exists alongside the full table while it is spilled or merged.
+static long long table_entry_bytes(const string& word) {
+    long long bytes = sizeof(void*) + sizeof(size_t) + sizeof(pair<const string, int>) + sizeof(void*);
+    if (word.capacity() > string().capacity()) {
+        bytes += word.capacity() + 1;
+    }
+    return bytes;
+}
+
+// Peak resident set size over the process's whole lifetime, in bytes. macOS reports ru_maxrss in bytes, Linux in kilobytes.
+static long long lifetime_peak_rss_bytes() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return (long long)usage.ru_maxrss;
+#else
+    return (long long)usage.ru_maxrss * 1024;
+#endif
+}
+
+// Resets the kernel's peak resident set size (VmHWM) so the next read_peak_rss_bytes() only covers what happens after this call.
+// Only supported on Linux. returns true if the reset was successful
+static bool reset_peak_rss() {
+    ofstream clear_refs("/proc/self/clear_refs");
+    clear_refs << "5";
+    clear_refs.close();
+    return bool(clear_refs);
+}
+
+// Peak resident set size since the last reset_peak_rss(), in bytes. Returns 0 if /proc/self/status can't be read.
+static long long read_peak_rss_bytes() {
+    ifstream status("/proc/self/status");
+    string line;
+    while (getline(status, line)) {
+        if (line.rfind("VmHWM:", 0) == 0) {
+            try {
+                return stoll(line.substr(6)) * 1024;
+            }
+            catch (...) {
+                return 0;
+            }
+        }
+    }
+    return 0;
+}
+
+// The single tie rule for external_memory: a higher count wins, and on equal counts the alphabetically first word wins,
+// so the result doesn't depend on hash order or on how the words were split into runs
+static void update_most_common_word(const string& word, int count, AnalyzerData* out_data) {
+    if (count > out_data->most_common_word_occurences ||
+        (count == out_data->most_common_word_occurences && word < out_data->most_common_word)) {
+        out_data->most_common_word = word;
+        out_data->most_common_word_occurences = count;
+    }
+}
+
+// Exact counting under a memory cap.
+// Words are counted in memory until the table reaches the budget, then the table is written out as a sorted run file and cleared.
+// Once every file has been read, the run files are k-way merged to get the final counts.
+AnalyzerData* Analyzer::alg_external_memory() {
+    AnalyzerData* data = new AnalyzerData();
+    unordered_map<string, int> word_frequencies;    // No reserve() here, the bucket array counts against the budget
+
+    // Measure this run's own peak memory. Where the peak can't be reset, fall back to the lifetime peak, which only describes this run if this run raised it.
+    const bool peak_rss_was_reset = reset_peak_rss();
+    const long long lifetime_peak_rss_before = lifetime_peak_rss_bytes();
+
+    const long long budget_bytes = (long long)memory_budget_mb * 1024 * 1024;
+    long long entry_bytes = 0;      // Sum of table_entry_bytes() for every word in the table
+
+    // Run files go in their own directory so they can all be removed at the end.
+    // Without it the budget can't be kept, so the run fails rather than silently counting everything in memory.
+    error_code ec;
+    const filesys::path run_dir_path = filesys::temp_directory_path(ec) /
+        ("analyzer_runs_" + to_string(chrono::steady_clock::now().time_since_epoch().count()));
+    if (ec) {
+        data->error = "no temporary directory is available for run files, so the memory budget can't be kept.";
+        return data;
+    }
+    if (!filesys::create_directories(run_dir_path, ec)) {
+        data->error = "a directory for run files could not be created at " + run_dir_path.string() + ", so the memory budget can't be kept.";
+        return data;
+    }
+    vector<filesys::path> run_paths;
+
+    // Get raw data per file. Reading stops early if a run can't be written.
+    for (const auto& book_path_it : filesys::directory_iterator(book_dir_path)) {
+        if (!data->error.empty()) {
+            break;
+        }
+
+        ifstream book(string(book_path_it.path()), std::ios::in);
+        if(!book) {
+            continue;
+        }
+
+        // Actual data retrieval occurs here; rest is file management
+        string line;
+        while(data->error.empty() && getline(book, line)) {
+            string current_word = "";
+            for(char ch : line) {
+                if (!isalpha(ch)) {
+                    if (!current_word.empty()) {
+                        data->average_word_length += current_word.length();   // division is performed once after all files have been read
+                        ++data->total_words;
+                        if (data->longest_word.length() < current_word.length()) {
+                            data->longest_word = current_word;
+                        }
+
+                        auto [word_it, inserted] = word_frequencies.try_emplace(current_word, 0);
+                        ++word_it->second;
+
+                        if (inserted) {
+                            entry_bytes += table_entry_bytes(word_it->first);
+                            const long long table_bytes = entry_bytes + (long long)(word_frequencies.bucket_count() * sizeof(void*));
+                            data->peak_table_bytes = max(data->peak_table_bytes, table_bytes);
+
+                            // Table is full, so write it out as a run and start over
+                            if (table_bytes >= budget_bytes && data->error.empty()) {
+                                const filesys::path run_path = run_dir_path / ("run_" + to_string(run_paths.size()) + ".bin");
+                                if (write_run(word_frequencies, run_path, data)) {
+                                    run_paths.push_back(run_path);
+                                    // Swap with an empty map so the bucket array is freed as well
+                                    unordered_map<string, int>().swap(word_frequencies);
+                                    entry_bytes = 0;
+                                }
+                                else {
+                                    data->error = "run file " + run_path.string() + " could not be written, so the memory budget can't be kept.";
+                                }
+                            }
+                        }
+
+                        current_word = "";
+                    }
+                }
+                else {
+                    current_word += ch;
+                }
+            }
+        }
+    }
+
+    // Process data
+    data->average_word_length /= double(data->total_words);
+
+    if (!data->error.empty()) {
+        // Nothing more to do, the statistics are incomplete
+    }
+    else if (run_paths.empty()) {
+        // Everything fit in memory, so no merge is needed
+        for (const auto& [word, count] : word_frequencies) {
+            update_most_common_word(word, count, data);
+        }
+        data->num_unique_words = word_frequencies.size();
+    }
+    else {
+        // Whatever is left in the table is merged straight from memory, as long as the table and one reader per run fit in the budget together.
+        // Otherwise it becomes one more run, and the merge runs with only the readers in memory.
+        const long long table_bytes = entry_bytes + (long long)(word_frequencies.bucket_count() * sizeof(void*));
+        if (run_paths.size() + 1 > merge_fan_in() || table_bytes + (long long)run_paths.size() * RUN_READER_BYTES > budget_bytes) {
+            const filesys::path run_path = run_dir_path / ("run_" + to_string(run_paths.size()) + ".bin");
+            if (write_run(word_frequencies, run_path, data)) {
+                run_paths.push_back(run_path);
+                unordered_map<string, int>().swap(word_frequencies);
+            }
+            else {
+                data->error = "run file " + run_path.string() + " could not be written, so the memory budget can't be kept.";
+            }
+        }
+
+        if (data->error.empty()) {
+            merge_runs(run_paths, word_frequencies, run_dir_path, data);
+        }
+    }
+
+    filesys::remove_all(run_dir_path, ec);
+
+    if (peak_rss_was_reset) {
+        data->peak_rss_bytes = read_peak_rss_bytes();
+    }
+    if (data->peak_rss_bytes == 0) {
+        const long long lifetime_peak_rss_after = lifetime_peak_rss_bytes();
+        data->peak_rss_bytes = lifetime_peak_rss_after > lifetime_peak_rss_before ? lifetime_peak_rss_after : 0;
+    }
+
+    return data;
+}
+
+// Pointers to the table's entries, sorted by word
+static vector<const pair<const string, int>*> sorted_entries(const unordered_map<string, int>& word_frequencies) {
+    vector<const pair<const string, int>*> entries;
+    entries.reserve(word_frequencies.size());
+    for (const auto& entry : word_frequencies) {
+        entries.push_back(&entry);
+    }
+    sort(entries.begin(), entries.end(), [](const pair<const string, int>* a, const pair<const string, int>* b) { return a->first < b->first; });
+    return entries;
+}
+
+// Appends one record to a run file. Each record is a 32-bit word length, the word's characters, then its 32-bit count.
+// returns the number of bytes written
+static long long write_record(ofstream& run, const string& word, int count) {
+    const uint32_t length = word.length();
+    const int32_t record_count = count;
+    run.write(reinterpret_cast<const char*>(&length), sizeof(length));
+    run.write(word.data(), length);
+    run.write(reinterpret_cast<const char*>(&record_count), sizeof(record_count));
+    return sizeof(length) + length + sizeof(record_count);
+}
+
+// Writes the table to disk sorted by word, in write_record()'s format.
+// returns true if the run was written successfully
+bool Analyzer::write_run(const unordered_map<string, int>& word_frequencies, const filesys::path& run_path, AnalyzerData* out_data) {
+    const vector<const pair<const string, int>*> entries = sorted_entries(word_frequencies);
+
+    ofstream run(run_path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!run) {
+        return false;
+    }
+
+    long long bytes_written = 0;
+    for (const pair<const string, int>* entry : entries) {
+        bytes_written += write_record(run, entry->first, entry->second);
+    }
+
+    run.close();
+    if (!run) {
+        return false;
+    }
+
+    out_data->spill_bytes += bytes_written;
+    ++out_data->spill_runs;
+    return true;
+}
+
+// How many runs can be open at once while merging: one reader per run has to fit in the memory budget
+size_t Analyzer::merge_fan_in() {
+    const long long budget_bytes = (long long)memory_budget_mb * 1024 * 1024;
+    return clamp<size_t>(budget_bytes / RUN_READER_BYTES, 2, MAX_MERGE_FAN_IN);
+}
+
+// Merges the sorted run files into the final counts, which gives num_unique_words and the most common word
+// without holding the whole vocabulary in memory. Ties are broken by update_most_common_word().
+// If there are more runs than merge_fan_in() allows open at once, groups of runs are first merged into bigger runs in run_dir_path.
+// The words still in memory join the final merge only. On failure out_data->error is set, since the counts would be wrong.
+void Analyzer::merge_runs(const vector<filesys::path>& run_paths, const unordered_map<string, int>& word_frequencies, const filesys::path& run_dir_path, AnalyzerData* out_data) {
+    const unordered_map<string, int> no_words;
+    const size_t fan_in = merge_fan_in();
+    vector<filesys::path> pending = run_paths;
+    size_t merged_runs = 0;
+
+    while (pending.size() > fan_in) {
+        vector<filesys::path> merged;
+        for (size_t first = 0; first < pending.size(); first += fan_in) {
+            const vector<filesys::path> group(pending.begin() + first, pending.begin() + min(first + fan_in, pending.size()));
+            if (group.size() == 1) {
+                merged.push_back(group[0]);
+                continue;
+            }
+
+            const filesys::path merged_path = run_dir_path / ("merged_" + to_string(merged_runs++) + ".bin");
+            ofstream merged_run(merged_path, std::ios::out | std::ios::binary | std::ios::trunc);
+            long long bytes_written = 0;
+            const bool success = merged_run && merge_sorted(group, no_words, [&](const string& word, int count) {
+                bytes_written += write_record(merged_run, word, count);
+            }, out_data);
+            merged_run.close();
+            if (!success || !merged_run) {
+                if (out_data->error.empty()) {
+                    out_data->error = "run file " + merged_path.string() + " could not be written.";
+                }
+                return;
+            }
+
+            out_data->spill_bytes += bytes_written;
+            error_code ec;
+            for (const filesys::path& run_path : group) {
+                filesys::remove(run_path, ec);
+            }
+            merged.push_back(merged_path);
+        }
+        pending.swap(merged);
+    }
+
+    merge_sorted(pending, word_frequencies, [out_data](const string& word, int count) {
+        ++out_data->num_unique_words;
+        update_most_common_word(word, count, out_data);
+    }, out_data);
+}
+
+// k-way merge of sorted run files plus the sorted words of an in-memory table.
+// emit is called once per word, in alphabetical order, with the word's counts summed across every source.
+// returns false and sets out_data->error if a run can't be opened or read completely
+bool Analyzer::merge_sorted(const vector<filesys::path>& run_paths, const unordered_map<string, int>& word_frequencies, const function<void(const string&, int)>& emit, AnalyzerData* out_data) {
+    // Reads one record at a time from a run file, or from the sorted in-memory entries if entries is set
+    struct RunReader {
+        ifstream run;
+        uintmax_t remaining_bytes = 0;  // Unread bytes in the run file
+        bool failed = false;            // Set if the run file ended in the middle of a record
+        const vector<const pair<const string, int>*>* entries = nullptr;
+        size_t position = 0;
+        string word;
+        int count = 0;
+
+        // returns false once the run is exhausted or can't be read
+        bool next() {
+            if (entries) {
+                if (position == entries->size()) {
+                    return false;
+                }
+                word = (*entries)[position]->first;
+                count = (*entries)[position]->second;
+                ++position;
+                return true;
+            }
+
+            if (remaining_bytes == 0) {
+                return false;
+            }
+
+            // A record needs a length, that many characters and a count, so anything shorter means the run is damaged
+            uint32_t length = 0;
+            int32_t record_count = 0;
+            if (remaining_bytes < sizeof(length) + sizeof(record_count) ||
+                !run.read(reinterpret_cast<char*>(&length), sizeof(length)) ||
+                length > remaining_bytes - sizeof(length) - sizeof(record_count)) {
+                failed = true;
+                return false;
+            }
+            word.resize(length);
+            run.read(word.data(), length);
+            run.read(reinterpret_cast<char*>(&record_count), sizeof(record_count));
+            if (!run) {
+                failed = true;
+                return false;
+            }
+
+            remaining_bytes -= sizeof(length) + length + sizeof(record_count);
+            count = record_count;
+            return true;
+        }
+    };
+
+    const vector<const pair<const string, int>*> entries = sorted_entries(word_frequencies);
+    vector<RunReader> readers(run_paths.size() + 1);
+
+    // Min-heap of reader indices, ordered by each reader's current word
+    auto greater_word = [&readers](size_t a, size_t b) { return readers[a].word > readers[b].word; };
+    priority_queue<size_t, vector<size_t>, decltype(greater_word)> heap(greater_word);
+
+    for (size_t i = 0; i < run_paths.size(); ++i) {
+        error_code ec;
+        readers[i].remaining_bytes = filesys::file_size(run_paths[i], ec);
+        readers[i].run.open(run_paths[i], std::ios::in | std::ios::binary);
+        if (ec || !readers[i].run) {
+            out_data->error = "run file " + run_paths[i].string() + " could not be opened.";
+            return false;
+        }
+        if (readers[i].next()) {
+            heap.push(i);
+        }
+    }
+    readers.back().entries = &entries;
+    if (readers.back().next()) {
+        heap.push(readers.size() - 1);
+    }
+
+    while (!heap.empty()) {
+        const string word = readers[heap.top()].word;
+        int count = 0;
+
+        // Every run holds a word at most once, so equal words are all at the top of the heap together
+        while (!heap.empty() && readers[heap.top()].word == word) {
+            const size_t i = heap.top();
+            heap.pop();
+            count += readers[i].count;
+            if (readers[i].next()) {
+                heap.push(i);
+            }
+        }
+
+        emit(word, count);
+    }
+
+    for (size_t i = 0; i < run_paths.size(); ++i) {
+        if (readers[i].failed) {
+            out_data->error = "run file " + run_paths[i].string() + " could not be read completely.";
+            return false;
+        }
+    }
+
+    return true;
+}
+
 // Wrapper for running correct alg function and determining processing time
 const AnalyzerData* Analyzer::run_analysis() {
     AnalyzerData* data = nullptr;
@@ -201,6 +615,9 @@ const AnalyzerData* Analyzer::run_analysis() {
         case(ALG::MULTI_THREAD_1):
             data = alg_multi_thread_1();
         break;
+        case(ALG::EXTERNAL_MEMORY):
+            data = alg_external_memory();
+        break;
         default:
             data = alg_single_thread();
         break;
@@ -237,4 +654,14 @@ bool Analyzer::set_threads(int desired_threads) {
     int hardware_limit = max(thread::hardware_concurrency(), 2u);
     num_threads = clamp(desired_threads, 2, hardware_limit);
     return num_threads == desired_threads;
+}
+
+int Analyzer::get_memory_budget() {
+    return memory_budget_mb;
+}
+
+// returns true if assignment was successful
+bool Analyzer::set_memory_budget(int desired_megabytes) {
+    memory_budget_mb = clamp(desired_megabytes, MIN_MEMORY_BUDGET_MB, MAX_MEMORY_BUDGET_MB);
+    return memory_budget_mb == desired_megabytes;
 }
\ No newline at end of file
@@ -9,13 +9,15 @@
 #include <unordered_map>
 #include <chrono>
 #include <mutex>
+#include <functional>
 
 // Keeps track of which algorithm is being used.
 enum class ALG {
     SINGLE_THREAD,
     MULTI_THREAD_1,
     MULTI_THREAD_2,
-    MULTI_THREAD_3
+    MULTI_THREAD_3,
+    EXTERNAL_MEMORY
 };
 
 // Different tasks a thread in the multithreading alg can take on.
@@ -35,6 +37,11 @@ struct AnalyzerData {
     int most_common_word_occurences;
     std::string most_common_word;
     std::string longest_word;
+    long long peak_table_bytes;     // Estimated peak size of the frequency table, only tracked by external_memory
+    long long peak_rss_bytes;       // Peak resident set size during the run, only tracked by external_memory. 0 if it couldn't be measured
+    std::string error;              // Set if the run failed and the other results can't be trusted
+    long long spill_bytes;          // Bytes written to run files, only tracked by external_memory
+    int spill_runs;
     AnalyzerData() {
         average_word_length = 0;
         processing_time = 0;
@@ -42,6 +49,11 @@ struct AnalyzerData {
         longest_word = "";
         most_common_word = "N/A";
         most_common_word_occurences = 0;
+        num_unique_words = 0;
+        peak_table_bytes = 0;
+        peak_rss_bytes = 0;
+        spill_bytes = 0;
+        spill_runs = 0;
     }
 };
 
@@ -53,13 +65,21 @@ public:
     bool set_alg(const std::string&);
     int get_threads();
     bool set_threads(int);
+    int get_memory_budget();
+    bool set_memory_budget(int);
 private:
     AnalyzerData* alg_single_thread();
     AnalyzerData* alg_multi_thread_1();
     void alg_mt1_thread(TASK, AnalyzerData*, std::unordered_map<std::string, int>&);
+    AnalyzerData* alg_external_memory();
+    bool write_run(const std::unordered_map<std::string, int>&, const std::filesystem::path&, AnalyzerData*);
+    void merge_runs(const std::vector<std::filesystem::path>&, const std::unordered_map<std::string, int>&, const std::filesystem::path&, AnalyzerData*);
+    bool merge_sorted(const std::vector<std::filesystem::path>&, const std::unordered_map<std::string, int>&, const std::function<void(const std::string&, int)>&, AnalyzerData*);
+    size_t merge_fan_in();
     // static void alg_mt1_thread(AnalyzerData*, std::vector<std::ifstream>, std::unordered_map<std::string, int>*, TASK);
 
     int num_threads;
+    int memory_budget_mb;   // Cap on the frequency table for external_memory, in megabytes
     ALG algorithm;
 
     std::mutex data_mutex;
@@ -0,0 +1,355 @@
+/*
+    Microbenchmarks for the hot components of the analyzer, measured in isolation.
+    Each kernel below mirrors the matching loop in Analyzer::alg_single_thread(), so an optimization
+    can be measured here before it gets wired into the Analyzer class.
+
+    USAGE:
+        ./microbench [BOOK_DIRECTORY] [REPETITIONS]
+
+    BOOK_DIRECTORY defaults to ./Books and REPETITIONS defaults to 5.
+    Every component is run REPETITIONS times per corpus and the best (lowest) time is reported.
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <filesystem>
+#include <fstream>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <utility>
+#include <ctype.h>
+
+using namespace std;
+
+namespace filesys = std::filesystem;
+
+// Text to benchmark against, plus its pre-split tokens so later stages can be timed on their own.
+struct Corpus {
+    string name;
+    string text;
+    vector<string> tokens;
+};
+
+// Describes a generated corpus.
+// Word lengths follow a Poisson distribution shifted to start at 1, and words are drawn from the vocabulary with Zipf (s = 1) weights,
+// which is roughly how word frequencies behave in natural text.
+struct SyntheticSpec {
+    size_t vocab_size;
+    double mean_word_length;
+    size_t target_bytes;
+};
+
+// What the tokenizer stage produces, minus the frequency map
+struct ScanResult {
+    long long total_words = 0;
+    double total_length = 0;
+    string longest_word = "";
+};
+
+// Keeps the compiler from optimizing away the work being measured
+static volatile size_t sink = 0;
+
+
+
+// Tokenizer stage: the per-line character loop, word count, word length sum and longest word.
+// The stream is created and rewound by the caller, so only reading it is timed.
+ScanResult kernel_tokenize(istream& book) {
+    ScanResult result;
+
+    string line;
+    while(getline(book, line)) {
+        string current_word = "";
+        for(char ch : line) {
+            if (!isalpha(ch)) {
+                if (!current_word.empty()) {
+                    result.total_length += current_word.length();
+                    ++result.total_words;
+                    if (result.longest_word.length() < current_word.length()) {
+                        result.longest_word = current_word;
+                    }
+
+                    current_word = "";
+                }
+            }
+            else {
+                current_word += ch;
+            }
+        }
+    }
+
+    return result;
+}
+
+// Frequency stage: the word_frequencies increment, fed with already split tokens.
+// The map is created, reserved and freed by the caller, so only the increments are timed.
+size_t kernel_count_frequencies(const vector<string>& tokens, unordered_map<string, int>& word_frequencies) {
+    for (const string& word : tokens) {
+        ++word_frequencies[word];
+    }
+
+    return word_frequencies.size();
+}
+
+// Post-processing stage: finding the most common word and the number of unique words
+size_t kernel_post_process(const unordered_map<string, int>& word_frequencies) {
+    auto most_common_word_it = max_element(word_frequencies.begin(), word_frequencies.end(), [](const pair<string, int>& a, const pair<string, int>& b) { return a.second < b.second; });
+    size_t result = word_frequencies.size();
+    if (most_common_word_it != word_frequencies.end()) {
+        result += most_common_word_it->second + most_common_word_it->first.length();
+    }
+
+    return result;
+}
+
+// Every stage together, the way alg_single_thread() runs them. The caller sets up the stream and map, like kernel_tokenize() and kernel_count_frequencies().
+size_t kernel_full(istream& book, unordered_map<string, int>& word_frequencies) {
+    ScanResult result;
+
+    string line;
+    while(getline(book, line)) {
+        string current_word = "";
+        for(char ch : line) {
+            if (!isalpha(ch)) {
+                if (!current_word.empty()) {
+                    result.total_length += current_word.length();
+                    ++result.total_words;
+                    if (result.longest_word.length() < current_word.length()) {
+                        result.longest_word = current_word;
+                    }
+
+                    ++word_frequencies[current_word];
+
+                    current_word = "";
+                }
+            }
+            else {
+                current_word += ch;
+            }
+        }
+    }
+
+    return kernel_post_process(word_frequencies) + result.total_words;
+}
+
+
+
+// Splits text into words exactly like kernel_tokenize(). Used for setup only, never timed.
+vector<string> collect_tokens(const string& text) {
+    vector<string> tokens;
+    istringstream book(text);
+
+    string line;
+    while(getline(book, line)) {
+        string current_word = "";
+        for(char ch : line) {
+            if (!isalpha(ch)) {
+                if (!current_word.empty()) {
+                    tokens.push_back(current_word);
+                    current_word = "";
+                }
+            }
+            else {
+                current_word += ch;
+            }
+        }
+    }
+
+    return tokens;
+}
+
+// Concatenates every readable file in the directory (in name order, so runs are comparable) into one corpus
+Corpus load_books(const filesys::path& book_dir_path) {
+    Corpus corpus;
+    corpus.name = book_dir_path.filename().string() + "/";
+
+    vector<filesys::path> book_paths;
+    for (const auto& book_path_it : filesys::directory_iterator(book_dir_path)) {
+        book_paths.push_back(book_path_it.path());
+    }
+    sort(book_paths.begin(), book_paths.end());
+
+    for (const filesys::path& book_path : book_paths) {
+        ifstream book(book_path, std::ios::in | std::ios::binary);
+        if (!book) {
+            continue;
+        }
+
+        ostringstream contents;
+        contents << book.rdbuf();
+        corpus.text += contents.str();
+        corpus.text += '\n';
+    }
+
+    corpus.tokens = collect_tokens(corpus.text);
+    return corpus;
+}
+
+// Builds a corpus from a spec. A fixed seed keeps the text identical between runs.
+Corpus generate_corpus(const SyntheticSpec& spec) {
+    Corpus corpus;
+    ostringstream name;
+    name << "synthetic(vocab=" << spec.vocab_size << ", len=" << spec.mean_word_length << ")";
+    corpus.name = name.str();
+
+    mt19937 rng(12345);
+    poisson_distribution<int> extra_length(spec.mean_word_length - 1.0);
+    uniform_int_distribution<int> letter('a', 'z');
+
+    // Build a vocabulary of distinct words
+    vector<string> vocabulary;
+    unordered_set<string> seen;
+    vocabulary.reserve(spec.vocab_size);
+    while (vocabulary.size() < spec.vocab_size) {
+        string word(1 + extra_length(rng), ' ');
+        for (char& ch : word) {
+            ch = char(letter(rng));
+        }
+        if (seen.insert(word).second) {
+            vocabulary.push_back(word);
+        }
+    }
+
+    // Zipf weights: the word at rank r shows up with probability proportional to 1/r
+    vector<double> weights(spec.vocab_size);
+    for (size_t i = 0; i < spec.vocab_size; ++i) {
+        weights[i] = 1.0 / double(i + 1);
+    }
+    discrete_distribution<size_t> pick_word(weights.begin(), weights.end());
+    uniform_int_distribution<int> words_per_line(6, 16);
+
+    // Lines always end in punctuation, so the last word of each line is counted like it would be in a book
+    corpus.text.reserve(spec.target_bytes + 64);
+    while (corpus.text.size() < spec.target_bytes) {
+        int line_length = words_per_line(rng);
+        for (int i = 0; i < line_length; ++i) {
+            corpus.text += vocabulary[pick_word(rng)];
+            corpus.text += (i + 1 == line_length) ? ".\n" : (i % 5 == 4 ? ", " : " ");
+        }
+    }
+
+    corpus.tokens = collect_tokens(corpus.text);
+    return corpus;
+}
+
+
+
+// Runs a callable repeatedly and returns the best wall clock time in nanoseconds.
+// setup() runs before every repetition and is not timed, so state can be reset without being measured.
+template <typename Setup, typename Func>
+double best_time_ns(int repetitions, Setup&& setup, Func&& func) {
+    double best = 0;
+    for (int i = 0; i < repetitions; ++i) {
+        setup();
+        const auto start = chrono::steady_clock::now();
+        sink = sink + func();
+        const auto end = chrono::steady_clock::now();
+
+        const double elapsed = chrono::duration_cast<chrono::duration<double, nano>>(end - start).count();
+        if (i == 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+
+    return best;
+}
+
+void print_header() {
+    cout <<
+    left << setw(44) << "CORPUS" << setw(16) << "COMPONENT" <<
+    right << setw(12) << "BEST (ms)" << setw(12) << "ns/byte" << setw(12) << "ns/token" << "\n";
+}
+
+void print_row(const Corpus& corpus, const string& component, double ns) {
+    cout <<
+    left << setw(44) << corpus.name << setw(16) << component <<
+    right << fixed << setprecision(3) <<
+    setw(12) << ns / 1e6 <<
+    setw(12) << ns / double(max<size_t>(corpus.text.size(), 1)) <<
+    setw(12) << ns / double(max<size_t>(corpus.tokens.size(), 1)) << "\n";
+}
+
+void run_benchmarks(const Corpus& corpus, int repetitions) {
+    cout << "\n" << corpus.name << ": " << corpus.text.size() << " bytes, " << corpus.tokens.size() << " tokens\n";
+
+    // Built once per corpus and shared by every stage, so copying the text and freeing the map are never timed
+    istringstream book(corpus.text);
+    unordered_map<string, int> word_frequencies;
+
+    auto rewind_book = [&]() {
+        book.clear();
+        book.seekg(0);
+    };
+    // Freeing the previous repetition's map happens here, outside the timed region
+    auto reset_frequencies = [&]() {
+        unordered_map<string, int>().swap(word_frequencies);
+        word_frequencies.reserve(109000);   // same reservation as the analyzer
+    };
+    auto no_setup = []() {};
+
+    double ns = best_time_ns(repetitions, rewind_book, [&]() { return size_t(kernel_tokenize(book).total_words); });
+    print_row(corpus, "tokenize", ns);
+
+    ns = best_time_ns(repetitions, reset_frequencies, [&]() { return kernel_count_frequencies(corpus.tokens, word_frequencies); });
+    print_row(corpus, "hash_increment", ns);
+
+    // word_frequencies still holds the counts from the last hash_increment repetition
+    ns = best_time_ns(repetitions, no_setup, [&]() { return kernel_post_process(word_frequencies); });
+    print_row(corpus, "post_process", ns);
+
+    ns = best_time_ns(repetitions, [&]() { rewind_book(); reset_frequencies(); }, [&]() { return kernel_full(book, word_frequencies); });
+    print_row(corpus, "full", ns);
+    reset_frequencies();
+}
+
+int main(int argc, char* argv[]) {
+    filesys::path book_dir_path = filesys::current_path() / "Books";
+    int repetitions = 5;
+
+    if (argc > 1) {
+        book_dir_path = argv[1];
+    }
+    if (argc > 2) {
+        try {
+            repetitions = max(stoi(argv[2]), 1);
+        }
+        catch (...) {
+            cout << "\nERROR: REPETITIONS must be a positive integer.\n\n";
+            return 1;
+        }
+    }
+
+    vector<Corpus> corpora;
+
+    if (filesys::is_directory(book_dir_path)) {
+        corpora.push_back(load_books(book_dir_path));
+    }
+    else {
+        cout << "\nWARNING: " << book_dir_path << " is not a directory, only synthetic corpora will be benchmarked.\n";
+    }
+
+    // Small and large vocabularies crossed with short and long words, each about the size of the bundled books
+    const vector<SyntheticSpec> specs = {
+        { 1000, 4.0, 8u << 20 },
+        { 1000, 8.0, 8u << 20 },
+        { 100000, 4.0, 8u << 20 },
+        { 100000, 8.0, 8u << 20 }
+    };
+    for (const SyntheticSpec& spec : specs) {
+        corpora.push_back(generate_corpus(spec));
+    }
+
+    cout << "\nRepetitions per component: " << repetitions << " (best time reported)\n\n";
+    print_header();
+    for (const Corpus& corpus : corpora) {
+        run_benchmarks(corpus, repetitions);
+    }
+    cout << "\n";
+
+    return 0;
+}
@@ -0,0 +1,619 @@
+#include "index.h"
+
+#include <string>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <utility>
+#include <cstdint>
+#include <ctype.h>
+
+using namespace std;
+
+namespace filesys = std::filesystem;
+
+
+
+// Init class consts
+const filesys::path InvertedIndex::book_dir_path = filesys::current_path() / "Books";
+const filesys::path InvertedIndex::index_file_path = filesys::current_path() / "Books.index";
+
+// Identifies the index file format
+static const char INDEX_MAGIC[4] = { 'W', 'I', 'D', 'X' };
+static const uint32_t INDEX_VERSION = 2;
+
+// How many word offsets to keep per book in search results
+static const size_t MAX_SHOWN_OFFSETS = 5;
+
+
+
+// Calls func(word, word_offset) for every word in the text.
+// Words are runs of letters, like in the analyzer, but are lowercased so searches aren't case sensitive.
+// Offsets keep counting across line breaks, so phrases can span lines.
+template <typename Func>
+static void for_each_word(const string& text, Func&& func) {
+    string current_word = "";
+    uint32_t word_offset = 0;
+
+    for (char ch : text) {
+        if (!isalpha(ch)) {
+            if (!current_word.empty()) {
+                func(current_word, word_offset);
+                ++word_offset;
+                current_word = "";
+            }
+        }
+        else {
+            current_word += char(tolower(ch));
+        }
+    }
+
+    // The text might not end with a non-letter
+    if (!current_word.empty()) {
+        func(current_word, word_offset);
+    }
+}
+
+// Fixed width helpers for the index file. Values are stored in the machine's byte order.
+static void write_u32(ofstream& out, uint32_t value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static void write_u64(ofstream& out, uint64_t value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static uint32_t read_u32(ifstream& in) {
+    uint32_t value = 0;
+    in.read(reinterpret_cast<char*>(&value), sizeof(value));
+    return value;
+}
+
+static uint64_t read_u64(ifstream& in) {
+    uint64_t value = 0;
+    in.read(reinterpret_cast<char*>(&value), sizeof(value));
+    return value;
+}
+
+// Last modification time of a file as a plain number, for comparing against the time stored in the index
+static int64_t write_time(const filesys::path& path, error_code& ec) {
+    return int64_t(filesys::last_write_time(path, ec).time_since_epoch().count());
+}
+
+// A (word, word offsets) entry of one book's map
+using BookEntry = pair<const string, vector<uint32_t>>;
+
+
+
+InvertedIndex::InvertedIndex() {
+    loaded = false;
+}
+
+// Builds the index with one book per thread at a time, then compresses the postings with the words split between threads.
+// The index is saved to disk once it has been built.
+const IndexData* InvertedIndex::build(int num_threads) {
+    IndexData* data = new IndexData();
+
+    const auto start = chrono::steady_clock::now();
+
+    vector<filesys::path> book_paths;
+    if (!list_books(book_paths)) {
+        data->error = book_dir_path.string() + " could not be listed, so the index was not built.";
+        return data;
+    }
+    if (book_paths.empty()) {
+        data->error = "no books were found in " + book_dir_path.string() + ", so the index was not built.";
+        return data;
+    }
+    const size_t num_books = book_paths.size();
+    num_threads = max(num_threads, 1);
+
+    // Pass 1: word offsets per book. Each thread takes the next book that hasn't been claimed yet.
+    // Each book's words are also split into one list per encoding thread here, so every word is hashed only once.
+    vector<unordered_map<string, vector<uint32_t>>> book_offsets(num_books);
+    vector<vector<vector<const BookEntry*>>> book_shards(num_books);
+    vector<uint64_t> sizes(num_books, 0);
+    vector<int64_t> write_times(num_books, 0);
+    vector<char> readable(num_books, 0);    // Not vector<bool>, since threads write to neighbouring elements
+    atomic<size_t> next_book(0);
+
+    auto index_books = [&]() {
+        const hash<string> hasher;
+        for (size_t book_id = next_book++; book_id < num_books; book_id = next_book++) {
+            error_code ec;
+            write_times[book_id] = write_time(book_paths[book_id], ec);
+            ifstream book(book_paths[book_id], std::ios::in | std::ios::binary);
+            if (ec || !book) {
+                continue;
+            }
+
+            ostringstream contents;
+            contents << book.rdbuf();
+            const string text = contents.str();
+            sizes[book_id] = text.size();
+
+            unordered_map<string, vector<uint32_t>>& offsets = book_offsets[book_id];
+            for_each_word(text, [&offsets](const string& word, uint32_t word_offset) {
+                offsets[word].push_back(word_offset);
+            });
+
+            book_shards[book_id].resize(num_threads);
+            for (const BookEntry& entry : offsets) {
+                book_shards[book_id][hasher(entry.first) % num_threads].push_back(&entry);
+            }
+            readable[book_id] = 1;
+        }
+    };
+
+    vector<thread> threads(num_threads - 1);
+    for (thread& t : threads) {
+        t = thread(index_books);
+    }
+    index_books();
+    std::for_each(threads.begin(), threads.end(), mem_fn(&thread::join));
+
+    // An index missing a book could never be trusted again, so unreadable books stop the build and the previous index is kept
+    for (size_t book_id = 0; book_id < num_books; ++book_id) {
+        if (!readable[book_id]) {
+            data->error = book_paths[book_id].string() + " could not be read, so the index was not built.";
+            return data;
+        }
+    }
+
+    // Pass 2: compress postings. Words were split between threads by hash in pass 1, so no two threads touch the same word.
+    vector<unordered_map<string, vector<uint8_t>>> shards(num_threads);
+
+    auto encode_shard = [&](size_t shard) {
+        for (size_t book_id = 0; book_id < num_books; ++book_id) {
+            for (const BookEntry* entry : book_shards[book_id][shard]) {
+                const string& word = entry->first;
+                const vector<uint32_t>& offsets = entry->second;
+
+                vector<uint8_t>& encoded = shards[shard][word];
+                encode_varint(book_id, encoded);
+                encode_varint(offsets.size(), encoded);
+                uint32_t previous_offset = 0;
+                for (uint32_t word_offset : offsets) {
+                    encode_varint(word_offset - previous_offset, encoded);
+                    previous_offset = word_offset;
+                }
+            }
+        }
+    };
+
+    for (size_t i = 0; i < threads.size(); ++i) {
+        threads[i] = thread(encode_shard, i + 1);
+    }
+    encode_shard(0);
+    std::for_each(threads.begin(), threads.end(), mem_fn(&thread::join));
+
+    // Move everything into the final index. merge() relinks the map nodes, so nothing is copied.
+    postings.clear();
+    for (auto& shard : shards) {
+        postings.merge(shard);
+    }
+    book_names.clear();
+    for (const filesys::path& book_path : book_paths) {
+        book_names.push_back(book_path.filename().string());
+    }
+    book_sizes = sizes;
+    book_write_times = write_times;
+    loaded = true;
+
+    const auto end = chrono::steady_clock::now();
+    data->build_time = chrono::duration_cast<chrono::duration<double>>(end - start).count();
+
+    // Gather statistics
+    data->num_books = num_books;
+    data->num_unique_words = postings.size();
+    for (uint64_t size : sizes) {
+        data->bytes_read += size;
+    }
+    for (const auto& offsets : book_offsets) {
+        for (const auto& word_offsets : offsets) {
+            data->num_postings += word_offsets.second.size();
+        }
+    }
+    data->raw_postings_bytes = data->num_postings * 2 * sizeof(uint32_t);
+    for (const auto& word_postings : postings) {
+        data->compressed_bytes += word_postings.second.size();
+    }
+
+    if (save()) {
+        error_code ec;
+        const uintmax_t file_size = filesys::file_size(index_file_path, ec);
+        data->index_file_bytes = ec ? 0 : file_size;
+    }
+
+    return data;
+}
+
+// Searches for a single word. Input that splits into several words is rejected, since that is a phrase search.
+const SearchData* InvertedIndex::find(const std::string& word) {
+    const vector<string> words = split_words(word);
+    if (words.size() != 1) {
+        SearchData* data = new SearchData();
+        data->error = "\"" + word + "\" is " + to_string(words.size()) + " words, but find searches for exactly one. Use phrase to search for several words.";
+        return data;
+    }
+
+    double load_time = 0;
+    if (!ensure_loaded(load_time)) {
+        return nullptr;
+    }
+
+    SearchData* data = search(words);
+    data->load_time = load_time;
+    return data;
+}
+
+// Searches for words appearing one after another
+const SearchData* InvertedIndex::phrase(const std::string& words) {
+    double load_time = 0;
+    if (!ensure_loaded(load_time)) {
+        return nullptr;
+    }
+
+    SearchData* data = search(split_words(words));
+    data->load_time = load_time;
+    return data;
+}
+
+// Loads the index from disk if it isn't in memory yet, and times how long that took.
+// An index already in memory is checked against the books first, which only costs a directory listing and a few file stats.
+// returns true if an up to date index is available
+bool InvertedIndex::ensure_loaded(double& load_time) {
+    load_time = 0;
+    if (loaded) {
+        // The books may have changed since the index was built or loaded, and stale postings must not be used
+        if (books_unchanged()) {
+            return true;
+        }
+        loaded = false;
+        book_names.clear();
+        book_sizes.clear();
+        book_write_times.clear();
+        postings.clear();
+        return false;
+    }
+
+    const auto start = chrono::steady_clock::now();
+    const bool success = load();
+    const auto end = chrono::steady_clock::now();
+    load_time = chrono::duration_cast<chrono::duration<double>>(end - start).count();
+
+    return success;
+}
+
+// Finds every place where the words occur consecutively.
+// Starting from the first word's offsets, each following word keeps only the offsets where it appears the right distance after them.
+SearchData* InvertedIndex::search(const vector<string>& words) {
+    SearchData* data = new SearchData();
+
+    const auto start = chrono::steady_clock::now();
+
+    vector<vector<vector<uint32_t>>> word_postings;
+    for (const string& word : words) {
+        word_postings.push_back(decode_postings(word));
+    }
+
+    for (size_t book_id = 0; book_id < book_names.size() && !words.empty(); ++book_id) {
+        vector<uint32_t> matches = word_postings[0][book_id];
+
+        for (size_t i = 1; i < words.size() && !matches.empty(); ++i) {
+            const vector<uint32_t>& next_offsets = word_postings[i][book_id];
+            vector<uint32_t> kept;
+            size_t j = 0;
+            for (uint32_t word_offset : matches) {
+                while (j < next_offsets.size() && next_offsets[j] < word_offset + i) {
+                    ++j;
+                }
+                if (j < next_offsets.size() && next_offsets[j] == word_offset + i) {
+                    kept.push_back(word_offset);
+                }
+            }
+            matches.swap(kept);
+        }
+
+        if (!matches.empty()) {
+            BookMatches book;
+            book.book = book_names[book_id];
+            book.count = matches.size();
+            book.first_offsets.assign(matches.begin(), matches.begin() + min(matches.size(), MAX_SHOWN_OFFSETS));
+            data->total_matches += book.count;
+            data->books.push_back(book);
+        }
+    }
+
+    const auto end = chrono::steady_clock::now();
+    data->query_time = chrono::duration_cast<chrono::duration<double>>(end - start).count();
+
+    return data;
+}
+
+// Decompresses a word's postings into a list of word offsets per book id.
+// Postings are checked when the index is loaded, so a failure here would only mean the index was changed in memory; decoding stops at that point.
+vector<vector<uint32_t>> InvertedIndex::decode_postings(const string& word) {
+    vector<vector<uint32_t>> offsets(book_names.size());
+
+    const auto postings_it = postings.find(word);
+    if (postings_it != postings.end()) {
+        read_postings(postings_it->second, book_names.size(), &offsets);
+    }
+
+    return offsets;
+}
+
+// Walks one word's compressed postings and checks that they are well formed:
+// every varint ends inside the block, book ids are in range and increasing, each count fits in the bytes left
+// (every offset takes at least one byte), and offsets increase without overflowing.
+// If offsets is not null, the decoded word offsets are stored in it by book id.
+// returns false at the first problem found
+bool InvertedIndex::read_postings(const vector<uint8_t>& encoded, size_t num_books, vector<vector<uint32_t>>* offsets) {
+    size_t position = 0;
+    long long previous_book_id = -1;
+
+    while (position < encoded.size()) {
+        uint32_t book_id = 0;
+        uint32_t count = 0;
+        if (!decode_varint(encoded, position, book_id) || book_id >= num_books || (long long)book_id <= previous_book_id) {
+            return false;
+        }
+        if (!decode_varint(encoded, position, count) || count == 0 || count > encoded.size() - position) {
+            return false;
+        }
+        previous_book_id = book_id;
+
+        vector<uint32_t>* book_offsets = offsets ? &(*offsets)[book_id] : nullptr;
+        if (book_offsets) {
+            book_offsets->reserve(count);
+        }
+
+        uint64_t word_offset = 0;
+        for (uint32_t i = 0; i < count; ++i) {
+            uint32_t delta = 0;
+            if (!decode_varint(encoded, position, delta) || (i > 0 && delta == 0)) {
+                return false;
+            }
+            word_offset += delta;
+            if (word_offset > UINT32_MAX) {
+                return false;
+            }
+            if (book_offsets) {
+                book_offsets->push_back(uint32_t(word_offset));
+            }
+        }
+    }
+
+    return true;
+}
+
+// Reads the index file written by save().
+// Every length in the file is checked against the bytes left in it before anything is allocated, so a damaged file is rejected instead of crashing.
+// returns true if the file was read successfully and still matches the books on disk
+bool InvertedIndex::load() {
+    error_code ec;
+    uintmax_t remaining_bytes = filesys::file_size(index_file_path, ec);
+    ifstream in(index_file_path, std::ios::in | std::ios::binary);
+    if (ec || !in) {
+        return false;
+    }
+
+    // Claims the next bytes of the file. returns false if the file is too short to hold them
+    auto take = [&remaining_bytes](uintmax_t bytes) {
+        if (bytes > remaining_bytes) {
+            return false;
+        }
+        remaining_bytes -= bytes;
+        return true;
+    };
+
+    char magic[4];
+    if (!take(sizeof(magic) + sizeof(uint32_t))) {
+        return false;
+    }
+    in.read(magic, sizeof(magic));
+    if (!in || !equal(magic, magic + 4, INDEX_MAGIC) || read_u32(in) != INDEX_VERSION) {
+        return false;
+    }
+
+    book_names.clear();
+    book_sizes.clear();
+    book_write_times.clear();
+    postings.clear();
+
+    bool valid = take(sizeof(uint32_t));
+    const uint32_t num_books = valid ? read_u32(in) : 0;
+    for (uint32_t i = 0; i < num_books && valid && in; ++i) {
+        valid = take(sizeof(uint32_t));
+        const uint32_t name_length = valid ? read_u32(in) : 0;
+        valid = valid && take(uintmax_t(name_length) + 2 * sizeof(uint64_t));
+        if (valid) {
+            string name(name_length, ' ');
+            in.read(name.data(), name.size());
+            book_names.push_back(name);
+            book_sizes.push_back(read_u64(in));
+            book_write_times.push_back(int64_t(read_u64(in)));
+        }
+    }
+
+    valid = valid && take(sizeof(uint32_t));
+    const uint32_t num_words = valid ? read_u32(in) : 0;
+    // Every word needs at least its two lengths
+    valid = valid && num_words <= remaining_bytes / (2 * sizeof(uint32_t));
+    if (valid) {
+        postings.reserve(num_words);
+    }
+    for (uint32_t i = 0; i < num_words && valid && in; ++i) {
+        valid = take(sizeof(uint32_t));
+        const uint32_t word_length = valid ? read_u32(in) : 0;
+        valid = valid && take(uintmax_t(word_length) + sizeof(uint32_t));
+        if (!valid) {
+            break;
+        }
+        string word(word_length, ' ');
+        in.read(word.data(), word.size());
+
+        const uint32_t encoded_length = read_u32(in);
+        valid = take(encoded_length);
+        if (!valid) {
+            break;
+        }
+        vector<uint8_t> encoded(encoded_length);
+        in.read(reinterpret_cast<char*>(encoded.data()), encoded.size());
+
+        // A block that doesn't decode cleanly means the file is damaged, so the whole index is rejected
+        valid = in && read_postings(encoded, book_names.size(), nullptr);
+        postings.emplace(move(word), move(encoded));
+    }
+
+    loaded = valid && in && books_unchanged();
+    if (!loaded) {
+        book_names.clear();
+        book_sizes.clear();
+        book_write_times.clear();
+        postings.clear();
+    }
+
+    return loaded;
+}
+
+// Writes the index next to the books directory.
+// Layout: magic, version, the books (name, size and last write time), then every word followed by its compressed postings.
+// The file is written under a temporary name and then renamed, so an interrupted save never leaves a half written index behind.
+// returns true if the file was written successfully
+bool InvertedIndex::save() {
+    filesys::path temp_path = index_file_path;
+    temp_path += ".tmp";
+
+    ofstream out(temp_path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!out) {
+        return false;
+    }
+
+    out.write(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    write_u32(out, INDEX_VERSION);
+
+    write_u32(out, book_names.size());
+    for (size_t i = 0; i < book_names.size(); ++i) {
+        write_u32(out, book_names[i].size());
+        out.write(book_names[i].data(), book_names[i].size());
+        write_u64(out, book_sizes[i]);
+        write_u64(out, uint64_t(book_write_times[i]));
+    }
+
+    write_u32(out, postings.size());
+    for (const auto& [word, encoded] : postings) {
+        write_u32(out, word.size());
+        out.write(word.data(), word.size());
+        write_u32(out, encoded.size());
+        out.write(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+    }
+
+    out.close();
+    error_code ec;
+    if (!out) {
+        filesys::remove(temp_path, ec);
+        return false;
+    }
+
+    filesys::rename(temp_path, index_file_path, ec);
+    if (ec) {
+        filesys::remove(temp_path, ec);
+        return false;
+    }
+
+    return true;
+}
+
+// An index is only trusted if the books directory still holds the same files with the same sizes and last write times.
+// Comparing write times catches edits that don't change a book's size.
+bool InvertedIndex::books_unchanged() {
+    vector<filesys::path> book_paths;
+    if (!list_books(book_paths) || book_paths.size() != book_names.size()) {
+        return false;
+    }
+
+    for (size_t i = 0; i < book_paths.size(); ++i) {
+        error_code ec;
+        const uintmax_t size = filesys::file_size(book_paths[i], ec);
+        if (ec || book_paths[i].filename().string() != book_names[i] || size != book_sizes[i]) {
+            return false;
+        }
+        if (write_time(book_paths[i], ec) != book_write_times[i] || ec) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Files in the books directory, sorted by name so book ids are the same every build.
+// returns false if the directory can't be listed
+bool InvertedIndex::list_books(vector<filesys::path>& book_paths) {
+    book_paths.clear();
+    error_code ec;
+    filesys::directory_iterator book_path_it(book_dir_path, ec);
+    if (ec) {
+        return false;
+    }
+
+    for (; book_path_it != filesys::directory_iterator(); book_path_it.increment(ec)) {
+        if (ec) {
+            return false;
+        }
+        if (book_path_it->is_regular_file()) {
+            book_paths.push_back(book_path_it->path());
+        }
+    }
+    if (ec) {
+        return false;
+    }
+    sort(book_paths.begin(), book_paths.end());
+
+    return true;
+}
+
+vector<string> InvertedIndex::split_words(const string& text) {
+    vector<string> words;
+    for_each_word(text, [&words](const string& word, uint32_t) {
+        words.push_back(word);
+    });
+
+    return words;
+}
+
+// Writes 7 bits per byte, low bits first. The high bit is set on every byte except the last.
+void InvertedIndex::encode_varint(uint32_t value, vector<uint8_t>& out) {
+    while (value >= 0x80) {
+        out.push_back(uint8_t(value) | 0x80);
+        value >>= 7;
+    }
+    out.push_back(uint8_t(value));
+}
+
+// Reads a value written by encode_varint() and moves position past it.
+// returns false if the varint runs past the end of the input or doesn't fit in 32 bits
+bool InvertedIndex::decode_varint(const vector<uint8_t>& in, size_t& position, uint32_t& value) {
+    uint64_t result = 0;
+    for (int shift = 0; position < in.size() && shift < 35; shift += 7) {
+        const uint8_t byte = in[position++];
+        result |= uint64_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            if (result > UINT32_MAX) {
+                return false;
+            }
+            value = uint32_t(result);
+            return true;
+        }
+    }
+
+    return false;
+}
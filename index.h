@@ -0,0 +1,92 @@
+/*
+    A class for building, saving and searching a positional inverted index of the books.
+    For every word, the index stores the (book, word offset) pairs where the word occurs,
+    so searches can be answered without rescanning the books.
+*/
+
+#include <string>
+#include <filesystem>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+// For returning build statistics to the CLI.
+struct IndexData {
+    double build_time;
+    long long bytes_read;           // Total size of the books that were indexed
+    long long num_postings;         // One posting per word occurrence
+    long long raw_postings_bytes;   // Size the postings would take as uncompressed 32-bit (book, offset) pairs
+    long long compressed_bytes;     // Size of the delta + varint encoded postings
+    long long index_file_bytes;     // Size of the index file on disk, 0 if it couldn't be saved
+    int num_books;
+    int num_unique_words;
+    std::string error;              // Set if the index couldn't be built
+    IndexData() {
+        build_time = 0;
+        bytes_read = 0;
+        num_postings = 0;
+        raw_postings_bytes = 0;
+        compressed_bytes = 0;
+        index_file_bytes = 0;
+        num_books = 0;
+        num_unique_words = 0;
+    }
+};
+
+// Where a word or phrase was found in one book.
+struct BookMatches {
+    std::string book;
+    int count;
+    std::vector<uint32_t> first_offsets;   // Word offsets of the first few matches
+    BookMatches() {
+        count = 0;
+    }
+};
+
+// For returning search results to the CLI.
+struct SearchData {
+    double query_time;
+    double load_time;               // Time spent loading the index from disk for this search, 0 if it was already loaded
+    int total_matches;
+    std::vector<BookMatches> books;
+    std::string error;              // Set if the query was invalid
+    SearchData() {
+        query_time = 0;
+        load_time = 0;
+        total_matches = 0;
+    }
+};
+
+class InvertedIndex {
+public:
+    InvertedIndex();
+    const IndexData* build(int num_threads);
+    const SearchData* find(const std::string& word);
+    const SearchData* phrase(const std::string& words);
+private:
+    bool ensure_loaded(double& load_time);
+    SearchData* search(const std::vector<std::string>& words);
+    std::vector<std::vector<uint32_t>> decode_postings(const std::string& word);
+    static bool read_postings(const std::vector<uint8_t>& encoded, size_t num_books, std::vector<std::vector<uint32_t>>* offsets);
+    bool load();
+    bool save();
+    bool books_unchanged();
+    static bool list_books(std::vector<std::filesystem::path>& book_paths);
+    static std::vector<std::string> split_words(const std::string& text);
+    static void encode_varint(uint32_t value, std::vector<uint8_t>& out);
+    static bool decode_varint(const std::vector<uint8_t>& in, size_t& position, uint32_t& value);
+
+    bool loaded;
+
+    // Indexed books, in the order that postings refer to them
+    std::vector<std::string> book_names;
+    std::vector<uint64_t> book_sizes;
+    std::vector<int64_t> book_write_times;
+
+    // Compressed postings per word. For each book the word occurs in:
+    // varint(book id), varint(number of offsets), then the word offsets as varint deltas from the previous offset
+    std::unordered_map<std::string, std::vector<uint8_t>> postings;
+
+    static const std::filesystem::path book_dir_path;
+    static const std::filesystem::path index_file_path;
+};